@@ -1,11 +1,33 @@
+#define _XOPEN_SOURCE 700  // mkstemp, futimens and fchmod in strict -std modes
+#define _DEFAULT_SOURCE    // flock on glibc
+#define _DARWIN_C_SOURCE   // flock on macOS
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <time.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define BMP_HEADER_SIZE 54  // Standard BMP header size (for BMP images)
 #define MAX_THREADS 12      // Maximum number of threads (1,3,6,9,12)
+#define CACHE_DEFAULT_LIMIT_MB 256  // Default size limit of the result cache
+#define CACHE_STALE_TMP_SECONDS 3600 // Age after which a temporary entry is assumed to be from a crashed writer
+#define BORDER_MODE "skip"          // Border pixels are not convolved by apply_filter
+#define OUTPUT_FORMAT "bmp24"       // Output is written as a 24-bit BMP
+
+// Nanosecond part of a file's modification time (the field name differs on macOS)
+#ifdef __APPLE__
+#define STAT_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
 
 // Structure to store thread-related data
 typedef struct {
@@ -18,6 +40,12 @@ typedef struct {
 unsigned char *image, *output_image;  // Pointers to store original and processed image data
 int width, height, stride;        // Image dimensions and row padding
 
+// Result cache settings (the cache is disabled when cache_dir is NULL)
+const char *cache_dir = NULL;     // Directory holding cached outputs
+long long cache_limit = (long long)CACHE_DEFAULT_LIMIT_MB << 20;  // Size limit in bytes
+int cache_hits = 0, cache_misses = 0;  // Hit/miss statistics for the timing log
+int output_is_mapped = 0;         // Set when output_image points into a cached file
+
 // Convolution kernel (3x3 sharpening filter)
 int kernel[3][3] = {
     { 0, -1, 0 },
@@ -89,6 +117,188 @@ void* apply_filter(void *arg) {
     pthread_exit(NULL);
 }
 
+// Function to hash a block of memory (64-bit multiply/rotate mix over 8-byte words)
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL, prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t h = seed ^ (len * prime1);
+
+    // Process full 8-byte words
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        word *= prime2;
+        word = (word << 31) | (word >> 33);
+        h ^= word * prime1;
+        h = ((h << 27) | (h >> 37)) * prime1 + prime2;
+    }
+
+    // Process the remaining tail bytes
+    for (; len > 0; p++, len--) {
+        h ^= *p * prime1;
+        h = ((h << 11) | (h >> 53)) * prime2;
+    }
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    return h;
+}
+
+// Function to compute the cache key of the current image (pixels, kernel, border mode, output format)
+uint64_t cache_key(void) {
+    int dims[2] = { width, height };
+    uint64_t h = hash_bytes(dims, sizeof(dims), 0);
+    h = hash_bytes(image, (size_t)height * stride, h);
+    h = hash_bytes(kernel, sizeof(kernel), h);
+    h = hash_bytes(BORDER_MODE, strlen(BORDER_MODE), h);
+    return hash_bytes(OUTPUT_FORMAT, strlen(OUTPUT_FORMAT), h);
+}
+
+// Function to lock the cache directory against other processes (LOCK_SH or LOCK_EX)
+// The lock file is opened read-only (flock does not need write access), so users other than the
+// one who created it can lock the shared cache too
+int cache_lock(int operation) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/.lock", cache_dir);
+
+    int fd = open(path, O_RDONLY | O_CREAT, 0644);
+    if (fd >= 0 && flock(fd, operation) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) printf("Warning: Could not lock %s, continuing without a lock\n", path);
+    return fd;
+}
+
+// Function to release a lock taken with cache_lock
+void cache_unlock(int fd) {
+    if (fd < 0) return;
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+// Function to map a cached output into output_image (returns 1 on a hit)
+int cache_lookup(uint64_t key) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%016llx.out", cache_dir, (unsigned long long)key);
+
+    int lock = cache_lock(LOCK_SH);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        cache_unlock(lock);
+        return 0;
+    }
+
+    // Only accept an entry whose size matches the expected output
+    struct stat st;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == (off_t)height * stride) {
+        mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    // Refresh the modification time so that eviction treats the entry as recently used
+    if (mapped != MAP_FAILED) futimens(fd, NULL);
+    close(fd);
+    cache_unlock(lock);
+
+    if (mapped == MAP_FAILED) return 0;
+
+    // The mapping stays valid even if another process evicts the file
+    free(output_image);
+    output_image = (unsigned char *)mapped;
+    output_is_mapped = 1;
+    return 1;
+}
+
+// Function to evict least recently used entries until the cache fits its size limit
+// (the caller must hold the exclusive cache lock)
+void cache_evict(void) {
+    DIR *dir = opendir(cache_dir);
+    if (!dir) return;
+
+    char path[512];
+    struct dirent *entry;
+    long long total = 0;
+    int count = 0, capacity = 16;
+    struct { char name[64]; long long size; struct timespec mtime; } *entries = malloc(capacity * sizeof(*entries));
+
+    // Collect the size and last-use time of every cached output, and remove temporary entries
+    // left behind by writers that crashed before publishing them
+    time_t now = time(NULL);
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        struct stat st;
+        if (strncmp(entry->d_name, "tmp.", 4) == 0) {
+            snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+            if (stat(path, &st) == 0 && now - st.st_mtime > CACHE_STALE_TMP_SECONDS) unlink(path);
+            continue;
+        }
+        if (len < 4 || len >= sizeof(entries[0].name) || strcmp(entry->d_name + len - 4, ".out") != 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+        if (stat(path, &st) != 0) continue;
+
+        if (count == capacity) {
+            capacity *= 2;
+            entries = realloc(entries, capacity * sizeof(*entries));
+        }
+        strcpy(entries[count].name, entry->d_name);
+        entries[count].size = st.st_size;
+        entries[count].mtime.tv_sec = st.st_mtime;
+        entries[count].mtime.tv_nsec = STAT_MTIME_NSEC(st);
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    // Remove the oldest entry until the total size is within the limit
+    while (total > cache_limit && count > 0) {
+        int oldest = 0;
+        for (int i = 1; i < count; i++) {
+            if (entries[i].mtime.tv_sec < entries[oldest].mtime.tv_sec ||
+                (entries[i].mtime.tv_sec == entries[oldest].mtime.tv_sec &&
+                 entries[i].mtime.tv_nsec < entries[oldest].mtime.tv_nsec)) {
+                oldest = i;
+            }
+        }
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entries[oldest].name);
+        unlink(path);
+        total -= entries[oldest].size;
+        entries[oldest] = entries[--count];
+    }
+
+    free(entries);
+}
+
+// Function to store the processed output in the cache
+void cache_store(uint64_t key) {
+    char tmp_path[512], path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/tmp.XXXXXX", cache_dir);
+    snprintf(path, sizeof(path), "%s/%016llx.out", cache_dir, (unsigned long long)key);
+
+    // Write to a private temporary file so readers never see a partial entry
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        printf("Warning: Could not create cache entry in %s\n", cache_dir);
+        return;
+    }
+    // mkstemp creates the file as 0600; make it readable by other users sharing the cache
+    fchmod(fd, 0644);
+    FILE *file = fdopen(fd, "wb");
+    size_t written = fwrite(output_image, sizeof(unsigned char), height * stride, file);
+    if (fclose(file) != 0 || written != (size_t)height * stride) {
+        unlink(tmp_path);
+        return;
+    }
+
+    // Publish the entry atomically and trim the cache to its size limit
+    int lock = cache_lock(LOCK_EX);
+    if (rename(tmp_path, path) != 0) unlink(tmp_path);
+    cache_evict();
+    cache_unlock(lock);
+}
+
 // Function to save processed BMP image
 void save_bmp(const char *filename, unsigned char *header) {
     printf("\n[Task 4: Saving Processed BMP Image] - Started\n");
@@ -114,12 +324,34 @@ double run_experiment(const char *input_filename, const char *output_filename, i
     ThreadData thread_data[MAX_THREADS];
     struct timespec start, end;
 
+    // Hash the image before the timer starts, so cache misses time only the convolution
+    uint64_t key = 0;
+    if (cache_dir) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        key = cache_key();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("   [Cache] - Key computed in %f sec\n",
+               (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+
     printf("\n[Task 2 and 3: Creating Threads & Processing Image with RELU] - Started\n");
 
     clock_gettime(CLOCK_MONOTONIC, &start);
 
+    // Reuse a cached output for the same image and kernel if one exists
+    int cache_hit = 0;
+    if (cache_dir) {
+        cache_hit = cache_lookup(key);
+        if (cache_hit) cache_hits++;
+        else cache_misses++;
+    }
+
+    if (cache_hit) {
+        printf("   [Cache] - Hit for key %016llx, skipping convolution\n", (unsigned long long)key);
+    }
+
     // Create threads
-    for (int i = 0; i < num_threads; i++) {
+    for (int i = 0; i < num_threads && !cache_hit; i++) {
         thread_data[i].thread_id = i;
         thread_data[i].start_row = (height / num_threads) * i;
         thread_data[i].end_row = (i == num_threads - 1) ? height : (height / num_threads) * (i + 1);
@@ -128,7 +360,7 @@ double run_experiment(const char *input_filename, const char *output_filename, i
     }
 
     // Wait for all threads to complete
-    for (int i = 0; i < num_threads; i++) {
+    for (int i = 0; i < num_threads && !cache_hit; i++) {
         pthread_join(threads[i], NULL);
     }
 
@@ -143,10 +375,17 @@ double run_experiment(const char *input_filename, const char *output_filename, i
     // Save the output image
     save_bmp(output_filename, header);
 
+    // Store the result so later runs on the same input can skip the convolution
+    if (cache_dir && !cache_hit) {
+        cache_store(key);
+    }
+
     // Free allocated memory
     free(header);
     free(image);
-    free(output_image);
+    if (output_is_mapped) munmap(output_image, (size_t)height * stride);
+    else free(output_image);
+    output_is_mapped = 0;
 
     return time_taken;
 }
@@ -155,12 +394,25 @@ double run_experiment(const char *input_filename, const char *output_filename, i
 // Main function to run experiments
 int main(int argc, char *argv[]) {
     // Ensure a BMP file is provided
-    if (argc != 2) {
-        printf("Usage: %s <input BMP file>\n", argv[0]);
+    if (argc < 2 || argc > 4) {
+        printf("Usage: %s <input BMP file> [cache directory] [cache limit MB]\n", argv[0]);
         return 1;
     }
 
     const char *input_filename = argv[1];  // Read BMP file from command line
+
+    // Enable the result cache if a directory is given
+    if (argc >= 3) {
+        cache_dir = argv[2];
+        mkdir(cache_dir, 0755);
+    }
+    if (argc == 4) {
+        cache_limit = atoll(argv[3]) << 20;
+        if (cache_limit <= 0) {
+            printf("Error: Cache limit must be a positive number of MB\n");
+            return 1;
+        }
+    }
     const char *output_filename_template = "output_%d_threads.bmp";
 
     int threads[] = {1, 3, 6, 9, 12};
@@ -175,13 +427,23 @@ int main(int argc, char *argv[]) {
         sprintf(output_filename, output_filename_template, threads[i]);
 
         // Run the experiment with the given number of threads
+        int hits_before = cache_hits;
         double time_taken = run_experiment(input_filename, output_filename, threads[i]);
 
-        // Log execution time if valid
+        // Log execution time if valid (tagged with the cache outcome when caching is enabled)
         if (time_taken > 0) {
-            fprintf(log_file, "%d %f\n", threads[i], time_taken);
+            if (cache_dir) {
+                fprintf(log_file, "%d %f %s\n", threads[i], time_taken, cache_hits > hits_before ? "hit" : "miss");
+            } else {
+                fprintf(log_file, "%d %f\n", threads[i], time_taken);
+            }
         }
     }
+
+    // Log the cache statistics for this run
+    if (cache_dir) {
+        fprintf(log_file, "# cache hits %d misses %d\n", cache_hits, cache_misses);
+    }
     
     fclose(log_file);
     printf("\n[Program End] All Experiments Completed\n");
@@ -9,6 +9,9 @@ echo "" > timing_results.txt
 # Input image file
 INPUT_FILE="lena.bmp"
 
+# Optional result cache directory (leave empty to convolve on every run)
+CACHE_DIR=""
+
 # Check if input file exists
 if [ ! -f "$INPUT_FILE" ]; then
     echo "Error: Input file $INPUT_FILE not found"
@@ -29,7 +32,7 @@ do
     do
         echo "  Run $i of 5..."
         # Run the image processor and capture the execution time
-        ./image_processor "$INPUT_FILE"
+        ./image_processor "$INPUT_FILE" $CACHE_DIR
         
         # Extract the execution time for this thread count from timing_results.txt
         time_value=$(grep "^$threads " timing_results.txt | tail -1 | awk '{print $2}')
@@ -2,22 +2,120 @@
 #include <stdlib.h> 
 #include <stdint.h>
 #include <time.h>
+#include <string.h>
+#include <math.h>
 #include <omp.h>
 
 #define BMP_HEADER_SIZE 54  // Standard BMP header size (for BMP images)
+#define MAX_KERNEL_SIZE 31  // Largest supported kernel size (must be odd)
+#define MAX_BANK_KERNELS 8  // Most kernels applied together in filter-bank mode
+#define CHUNK_BYTES 12288   // L1 share for the padded input rows of one column chunk
+#define STRIP_SAMPLES 64    // Row samples accumulated together in a fixed-size local array
+#define FFT_STRIP 8         // Columns per FFT butterfly strip (the smallest FFT size)
+#define FFT_MAX_SIZE 64     // Largest FFT tile, so that a block (real and imaginary parts) stays in L2
+#define PROFILE_FILENAME "openmp_algorithm_profile.txt"  // Autotuner calibration results
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846  // Not provided by <math.h> in strict ISO C modes
+#endif
+
+// Convolution algorithms that can compute the same filtered image
+typedef enum {
+    ALGO_AUTO = -1,   // Pick the fastest algorithm from the calibration profile
+    ALGO_DIRECT,      // Direct K x K loop
+    ALGO_SEPARABLE,   // Row pass followed by a column pass (rank-1 kernels only)
+    ALGO_FFT,         // Tiled FFT convolution (overlap-save)
+    NUM_ALGORITHMS
+} Algorithm;
+
+const char *algorithm_names[NUM_ALGORITHMS] = { "direct", "separable", "fft" };
+
+// Accumulator types for the direct and filter-bank paths, narrowest first
+typedef enum {
+    ACCUM_I16,    // 16-bit integer (twice the SIMD lanes of i32)
+    ACCUM_I32,    // 32-bit integer
+    ACCUM_FLOAT,  // Single precision float, when no integer format is safe and float rounding is small enough
+    ACCUM_DOUBLE, // Double precision, for ranges a float cannot represent to within half a gray level
+} Accumulator;
+
+const char *accumulator_names[] = { "i16", "i32", "float", "double" };
+
+// Result of analyse_kernel(): how a kernel is evaluated in fixed point
+typedef struct {
+    Accumulator accumulator;  // Narrowest accumulator that provably cannot overflow
+    int frac_bits;            // Q-format fractional bits of fixed_weights (0 for integer kernels)
+    int *fixed_weights;       // Weights scaled by 2^frac_bits and rounded
+    float *float_weights;     // Weights for the float accumulator
+    const double *weights;    // Weights for the double accumulator (the kernel's own)
+    long min_sum, max_sum;    // Worst-case accumulator range over all 0-255 inputs
+} KernelPlan;
+
+// Result of plan_separable(): an int32 row pass in Q-format followed by a float column pass
+typedef struct {
+    int use_fixed;                     // 0 when the plan is not accurate enough (double passes are used)
+    int row_bits;                      // Fractional bits of row_fixed
+    int row_fixed[MAX_KERNEL_SIZE];    // Row factor scaled by 2^row_bits and rounded
+    float col_scaled[MAX_KERNEL_SIZE]; // Column factor divided by 2^row_bits
+} SeparablePlan;
 
 // Declare global variables to store image data
 unsigned char *image = NULL;
 unsigned char *output_image = NULL;
 int width, height, stride;
 
-// Define a 3x3 convolution kernel for image sharpening
-int kernel[3][3] = {
-    { 0, -1, 0 },   // Top row: only attenuates the pixel above
-    { -1, 6, -1 },  // Middle row: emphasizes center pixel and attenuates horizontal neighbors
-    { 0, -1, 0 }    // Bottom row: only attenuates the pixel below
+// Rows held in memory: image starts at input_first_row and output buffers start at output_first_row
+// (the whole image unless processing out of core, see process_out_of_core)
+int input_first_row = 0, input_end_row = 0;
+int output_first_row = 0;
+
+// Define a 3x3 convolution kernel for image sharpening (used when no kernel file is given)
+double default_kernel[3 * 3] = {
+    0, -1, 0,   // Top row: only attenuates the pixel above
+    -1, 6, -1,  // Middle row: emphasizes center pixel and attenuates horizontal neighbors
+    0, -1, 0    // Bottom row: only attenuates the pixel below
 };
 
+// Active kernel, stored row-major as ksize x ksize weights
+double *kernel = default_kernel;
+int ksize = 3;
+
+// Factors of a separable kernel: kernel[a][b] == col_weights[a] * row_weights[b]
+double row_weights[MAX_KERNEL_SIZE], col_weights[MAX_KERNEL_SIZE];
+int kernel_is_separable = 0;
+SeparablePlan separable_plan;
+
+// Filter bank: several kernels applied in one pass, each writing its own output image
+// Kernels using the direct algorithm share one traversal; the others run their own algorithm
+double *bank_kernels[MAX_BANK_KERNELS];
+int bank_ksizes[MAX_BANK_KERNELS];
+KernelPlan bank_plans[MAX_BANK_KERNELS];
+SeparablePlan bank_separable_plans[MAX_BANK_KERNELS];
+Algorithm bank_algorithms[MAX_BANK_KERNELS];
+unsigned char *bank_outputs[MAX_BANK_KERNELS];
+int num_bank_kernels = 0;
+int active_kernel = 0;  // Bank index of kernel, ksize and output_image, see select_kernel
+
+// Scratch memory of the filters. It only grows and is kept between calls, so once it has been
+// reserved (see process_out_of_core) filtering a band allocates nothing.
+unsigned char **thread_scratch = NULL;  // One buffer per thread: padded input rows or an FFT block
+int num_thread_scratch = 0;
+size_t thread_scratch_size = 0;
+void *separable_partial = NULL;         // Row-pass results of apply_separable
+size_t separable_partial_size = 0;
+double fft_cos[FFT_MAX_SIZE / 2], fft_sin[FFT_MAX_SIZE / 2];  // exp(-2*pi*i*k/FFT_MAX_SIZE), see prepare_fft
+double *fft_spectra[MAX_BANK_KERNELS];  // Conjugated and scaled spectrum of each kernel (transposed)
+
+// Function to read the BMP header and set the image dimensions
+unsigned char* read_bmp_header(FILE *file) {
+    unsigned char *header = (unsigned char *)malloc(BMP_HEADER_SIZE);
+    fread(header, 1, BMP_HEADER_SIZE, file);
+    
+    width = *(int*)&header[18];
+    height = *(int*)&header[22];
+    stride = (width * 3 + 3) & (~3);
+    return header;
+}
+
 // Function to read a BMP image file
 unsigned char* read_bmp(const char *filename) {
     printf("\n[Task 1: Reading BMP Image] - Started\n");
@@ -28,12 +126,10 @@ unsigned char* read_bmp(const char *filename) {
         return NULL;
     }
     
-    unsigned char *header = (unsigned char *)malloc(BMP_HEADER_SIZE);
-    fread(header, 1, BMP_HEADER_SIZE, file);
-    
-    width = *(int*)&header[18];
-    height = *(int*)&header[22];
-    stride = (width * 3 + 3) & (~3);
+    unsigned char *header = read_bmp_header(file);
+    input_first_row = 0;
+    input_end_row = height;
+    output_first_row = 0;
     
     image = (unsigned char *)malloc(height * stride);
     fread(image, sizeof(unsigned char), height * stride, file);
@@ -43,146 +139,1338 @@ unsigned char* read_bmp(const char *filename) {
     return header;
 }
 
-// Function to apply convolution filter with RGB matrix approach to a specific row
-void process_row(int row) {
-    // Create arrays for each color channel of this row
-    int *red_values = (int *)malloc(width * sizeof(int));
-    int *green_values = (int *)malloc(width * sizeof(int));
-    int *blue_values = (int *)malloc(width * sizeof(int));
-    
-    if (!red_values || !green_values || !blue_values) {
-        printf("Error: Memory allocation failed for row matrices\n");
-        exit(1);
+// Function to read a kernel file: the (odd) kernel size followed by size * size weights
+// Weights may be fractional, e.g. 0.0625 for a normalised Gaussian
+int read_kernel(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Error: Could not open kernel file %s\n", filename);
+        return 0;
     }
 
-    // Process each color channel separately
-    for (int color = 0; color < 3; color++) {
-        // Select which array to use based on color channel
-        int *current_values;
-        if (color == 0) current_values = red_values;
-        else if (color == 1) current_values = green_values;
-        else current_values = blue_values;
-        
-        // Process each pixel in this row
-        for (int j = 0; j < width; j++) {
-            int sum = 0;
+    int size;
+    if (fscanf(file, "%d", &size) != 1 || size < 1 || size > MAX_KERNEL_SIZE || size % 2 == 0) {
+        printf("Error: Kernel size in %s must be odd and at most %d\n", filename, MAX_KERNEL_SIZE);
+        fclose(file);
+        return 0;
+    }
+
+    double *weights = (double *)malloc(size * size * sizeof(double));
+    for (int i = 0; i < size * size; i++) {
+        if (fscanf(file, "%lf", &weights[i]) != 1) {
+            printf("Error: Kernel file %s must contain %d weights\n", filename, size * size);
+            free(weights);
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+
+    kernel = weights;
+    ksize = size;
+    return 1;
+}
+
+// Function to check whether the kernel is an outer product (rank 1) and store its factors
+int check_separable(void) {
+    // Find the largest weight to use as the pivot of the factorisation
+    int pivot_row = 0, pivot_col = 0;
+    for (int i = 0; i < ksize * ksize; i++) {
+        if (fabs(kernel[i]) > fabs(kernel[pivot_row * ksize + pivot_col])) {
+            pivot_row = i / ksize;
+            pivot_col = i % ksize;
+        }
+    }
+    double pivot = kernel[pivot_row * ksize + pivot_col];
+    if (pivot == 0) return 0;
+
+    // Every 2x2 minor through the pivot must vanish for a rank-1 kernel
+    for (int a = 0; a < ksize; a++) {
+        for (int b = 0; b < ksize; b++) {
+            double lhs = kernel[a * ksize + b] * pivot;
+            double rhs = kernel[a * ksize + pivot_col] * kernel[pivot_row * ksize + b];
+            if (fabs(lhs - rhs) > 1e-9 * pivot * pivot) return 0;
+        }
+    }
+
+    for (int i = 0; i < ksize; i++) {
+        col_weights[i] = kernel[i * ksize + pivot_col];
+        row_weights[i] = kernel[pivot_row * ksize + i] / pivot;
+    }
+    return 1;
+}
+
+// Function to make a filter-bank kernel the active one (kernel, ksize, output_image and the
+// separable factors and plan used by the single-kernel algorithms)
+// The factors are recomputed rather than stored per kernel; that is only K^2 work
+void select_kernel(int n) {
+    active_kernel = n;
+    kernel = bank_kernels[n];
+    ksize = bank_ksizes[n];
+    output_image = bank_outputs[n];
+    kernel_is_separable = check_separable();
+    separable_plan = bank_separable_plans[n];
+}
+
+// Function to return a row of the input image, clamping out-of-range rows to the nearest edge
+// Rows outside the band held in memory are clamped to it; they only feed outputs beyond the band
+const unsigned char *input_row(int row) {
+    row = row < 0 ? 0 : (row >= height ? height - 1 : row);
+    row = row < input_first_row ? input_first_row : (row >= input_end_row ? input_end_row - 1 : row);
+    return image + (size_t)(row - input_first_row) * stride;
+}
+
+// Function to return a row of an output buffer
+unsigned char *output_row(unsigned char *output, int row) {
+    return output + (size_t)(row - output_first_row) * stride;
+}
+
+// Function to clamp a column index to the image width
+int clamp_col(int col) {
+    return col < 0 ? 0 : (col >= width ? width - 1 : col);
+}
+
+// Function to round a floating point convolution result and apply ReLU (clip to 0-255)
+unsigned char clip_pixel(double value) {
+    long rounded = lround(value);
+    return (unsigned char)(rounded < 0 ? 0 : (rounded > 255 ? 255 : rounded));
+}
+
+// Function to compute the worst-case accumulator range of integer weights over 0-255 inputs
+void weight_range(const int *weights, int count, long *min_sum, long *max_sum) {
+    *min_sum = 0;
+    *max_sum = 0;
+    for (int i = 0; i < count; i++) {
+        if (weights[i] < 0) *min_sum += 255L * weights[i];
+        else *max_sum += 255L * weights[i];
+    }
+}
+
+// Function to choose the narrowest safe accumulator for a kernel
+// Integer kernels are evaluated exactly (Q0). Fractional kernels use the largest Q-format that
+// fits the accumulator, provided the quantisation error stays below half a gray level.
+KernelPlan analyse_kernel(const double *weights, int size) {
+    KernelPlan plan;
+    int count = size * size;
+    plan.fixed_weights = (int *)malloc(count * sizeof(int));
+    plan.float_weights = (float *)malloc(count * sizeof(float));
+    plan.weights = weights;
+    for (int i = 0; i < count; i++) plan.float_weights[i] = (float)weights[i];
+
+    int is_integer = 1;
+    double abs_total = 0.0;
+    for (int i = 0; i < count; i++) {
+        if (weights[i] != floor(weights[i])) is_integer = 0;
+        abs_total += fabs(weights[i]);
+    }
+
+    long limits[2][2] = { { INT16_MIN, INT16_MAX }, { INT32_MIN, INT32_MAX } };
+    for (int accumulator = ACCUM_I16; accumulator <= ACCUM_I32; accumulator++) {
+        // Largest number of fractional bits whose scaled weights still fit the accumulator
+        int max_bits = is_integer ? 0 : 30;
+        for (int bits = max_bits; bits >= 0; bits--) {
+            if (abs_total * 255.0 * ldexp(1.0, bits) > (double)limits[accumulator][1]) continue;
+
+            double error = 0.0;
+            for (int i = 0; i < count; i++) {
+                double scaled = ldexp(weights[i], bits);
+                plan.fixed_weights[i] = (int)lround(scaled);
+                error += fabs(scaled - plan.fixed_weights[i]);
+            }
+
+            // The rounding offset added before the final shift is part of the range
+            weight_range(plan.fixed_weights, count, &plan.min_sum, &plan.max_sum);
+            if (bits > 0) plan.max_sum += 1L << (bits - 1);
+
+            if (plan.min_sum < limits[accumulator][0] || plan.max_sum > limits[accumulator][1]) continue;
+
+            // Fewer fractional bits only increase the error, so try the next accumulator instead
+            if (ldexp(error * 255.0, -bits) >= 0.5) break;
+            plan.accumulator = (Accumulator)accumulator;
+            plan.frac_bits = bits;
+            return plan;
+        }
+    }
+
+    // Float rounds each weight, product and partial sum by at most 2^-24 of the range, so it is only
+    // used while count + 2 such errors stay below half a gray level (this also keeps the range < 2^24)
+    plan.accumulator = (count + 2) * abs_total * 255.0 * ldexp(1.0, -24) < 0.5 ? ACCUM_FLOAT : ACCUM_DOUBLE;
+    plan.frac_bits = 0;
+    plan.min_sum = (long)floor(-abs_total * 255.0);
+    plan.max_sum = (long)ceil(abs_total * 255.0);
+    return plan;
+}
+
+// Function to plan a separable kernel: the row pass keeps exact int32 sums of the row factor in
+// Q-format and the column pass accumulates them in float. Splitting one int32 accumulator between
+// both factors left each with too few fractional bits, so only the row factor is quantised now.
+// The Q-format with the smallest error that fits int32 is used (the smallest one if several are
+// exact), provided the worst-case error stays below 1/256 of a gray level; that bound adds the row
+// quantisation error to the float rounding of each conversion, product and sum (2^-24 of the range).
+// Float is exact, and adds no error, when the column factor is dyadic and every sum is an integer
+// multiple of its least significant bit below 2^24.
+SeparablePlan plan_separable(void) {
+    SeparablePlan plan, best;
+    double best_error = -1.0;
+    best.use_fixed = 0;
+
+    double abs_col = 0.0;
+    for (int i = 0; i < ksize; i++) abs_col += fabs(col_weights[i]);
+
+    // Fewest fractional bits that represent the column factor exactly (-1 if it is not dyadic)
+    int col_bits = -1;
+    for (int bits = 0; bits <= 30 && col_bits < 0; bits++) {
+        col_bits = bits;
+        for (int i = 0; i < ksize; i++) {
+            double scaled = ldexp(col_weights[i], bits);
+            if (scaled != floor(scaled)) col_bits = -1;
+        }
+    }
+
+    for (int row_bits = 0; row_bits <= 30; row_bits++) {
+        double row_min = 0.0, row_max = 0.0, abs_row = 0.0;
+        for (int i = 0; i < ksize; i++) {
+            plan.row_fixed[i] = (int)lround(ldexp(row_weights[i], row_bits));
+            if (plan.row_fixed[i] < 0) row_min += 255.0 * plan.row_fixed[i];
+            else row_max += 255.0 * plan.row_fixed[i];
+            abs_row += fabs(ldexp(plan.row_fixed[i], -row_bits));
+        }
+        if (row_min < INT32_MIN || row_max > INT32_MAX) break;
+
+        double error = 0.0;
+        for (int a = 0; a < ksize; a++) {
+            for (int b = 0; b < ksize; b++) {
+                error += fabs(col_weights[a] * ldexp(plan.row_fixed[b], -row_bits) - kernel[a * ksize + b]);
+            }
+        }
+        double range = abs_row * abs_col * 255.0;
+        int float_exact = col_bits >= 0 && ldexp(range, row_bits + col_bits) <= ldexp(1.0, 24);
+        error = error * 255.0 + (float_exact ? 0.0 : (ksize + 3) * range * ldexp(1.0, -24));
+        if (error >= 1.0 / 256 || (best_error >= 0.0 && error >= best_error)) continue;
+
+        best = plan;
+        best.use_fixed = 1;
+        best.row_bits = row_bits;
+        for (int i = 0; i < ksize; i++) best.col_scaled[i] = (float)ldexp(col_weights[i], -row_bits);
+        best_error = error;
+    }
+    return best;
+}
+
+// Function to make sure every thread has a scratch buffer of at least size bytes
+unsigned char **reserve_thread_scratch(int num_threads, size_t size) {
+    if (num_threads > num_thread_scratch || size > thread_scratch_size) {
+        for (int t = 0; t < num_thread_scratch; t++) free(thread_scratch[t]);
+        free(thread_scratch);
+        if (num_threads < num_thread_scratch) num_threads = num_thread_scratch;
+        if (size < thread_scratch_size) size = thread_scratch_size;
+
+        thread_scratch = (unsigned char **)malloc(num_threads * sizeof(unsigned char *));
+        for (int t = 0; thread_scratch && t < num_threads; t++) {
+            thread_scratch[t] = (unsigned char *)calloc(size, 1);
+            if (!thread_scratch[t]) {
+                free(thread_scratch);
+                thread_scratch = NULL;
+            }
+        }
+        if (!thread_scratch) {
+            printf("Error: Memory allocation failed for row buffers\n");
+            exit(1);
+        }
+        num_thread_scratch = num_threads;
+        thread_scratch_size = size;
+    }
+    return thread_scratch;
+}
+
+// Function to make sure the separable intermediate holds at least size bytes
+void *reserve_separable_partial(size_t size) {
+    if (size > separable_partial_size) {
+        free(separable_partial);
+        separable_partial = malloc(size);
+        if (!separable_partial) {
+            printf("Error: Memory allocation failed for separable pass\n");
+            exit(1);
+        }
+        separable_partial_size = size;
+    }
+    return separable_partial;
+}
+
+// Function to free the scratch memory of the filters
+void free_scratch(void) {
+    for (int t = 0; t < num_thread_scratch; t++) free(thread_scratch[t]);
+    free(thread_scratch);
+    free(separable_partial);
+    for (int n = 0; n < MAX_BANK_KERNELS; n++) free(fft_spectra[n]);
+}
+
+// Function to choose how many row samples are filtered at a time for a size x size neighbourhood
+// A chunk's padded input rows and accumulators fit in L1, so every kernel reuses them from there
+int chunk_samples(int size) {
+    int pixels = CHUNK_BYTES / (3 * size);
+    return 3 * (pixels < 16 ? 16 : pixels);
+}
+
+// Function to compute the per-thread scratch size of filter_rows_chunked for a size x size neighbourhood
+// The last strip of a chunk may read up to STRIP_SAMPLES past the padded rows
+size_t chunk_scratch_size(int size) {
+    return (size_t)size * (chunk_samples(size) + (size / 2) * 2 * 3) + STRIP_SAMPLES;
+}
+
+// Function to copy samples [first, first + count) of an image row, where first is a multiple of 3
+// Samples left and right of the image repeat the edge pixel
+void load_padded_row(const unsigned char *img_row, int first, int count, unsigned char *padded_row) {
+    int row_size = width * 3;
+    int left = first < 0 ? -first : 0;
+    int right = first + count > row_size ? first + count - row_size : 0;
+
+    for (int p = 0; p < left; p++) padded_row[p] = img_row[p % 3];
+    memcpy(padded_row + left, img_row + first + left, count - left - right);
+    for (int p = count - right; p < count; p++) {
+        padded_row[p] = img_row[(width - 1) * 3 + (first + p - row_size) % 3];
+    }
+}
+
+// Function to load samples [x0, x0 + samples) of the input rows around an output row, plus radius
+// clamped pixels on each side; row a of the neighbourhood starts at padded + a * pitch
+void load_padded_rows(int row, int size, int x0, int samples, unsigned char *padded, int pitch) {
+    int radius = size / 2;
+    for (int a = 0; a < size; a++) {
+        load_padded_row(input_row(row - radius + a), x0 - radius * 3, samples + 2 * radius * 3,
+                        padded + (size_t)a * pitch);
+    }
+}
+
+// Function to filter samples of one output row with a planned k x k kernel
+// Samples are processed in strips of STRIP_SAMPLES whose accumulators are a local array, so every
+// weight is applied with full-width vector operations on data that never leaves L1.
+// padded holds the rows loaded for a size x size neighbourhood; smaller kernels use its centre
+// padded and out_row must not overlap: with restrict the strip loops vectorize at -O2 without alias checks
+void filter_row(const KernelPlan *plan, int k, const unsigned char *restrict padded, int size, int pitch,
+                int samples, unsigned char *restrict out_row) {
+    int offset = size / 2 - k / 2;
+    int bits = plan->frac_bits;
+    int rounding = bits > 0 ? 1 << (bits - 1) : 0;
+    const unsigned char *restrict first_row = padded + (size_t)offset * pitch + offset * 3;
+
+    for (int x0 = 0; x0 < samples; x0 += STRIP_SAMPLES) {
+        int count = samples - x0 < STRIP_SAMPLES ? samples - x0 : STRIP_SAMPLES;
+        unsigned char clipped[STRIP_SAMPLES];
+
+        if (plan->accumulator == ACCUM_I16) {
+            int16_t acc[STRIP_SAMPLES] = { 0 };
+            for (int a = 0; a < k; a++) {
+                for (int b = 0; b < k; b++) {
+                    int16_t weight = (int16_t)plan->fixed_weights[a * k + b];
+                    if (weight == 0) continue;
+                    const unsigned char *restrict src = first_row + (size_t)a * pitch + b * 3 + x0;
+                    for (int x = 0; x < STRIP_SAMPLES; x++) acc[x] = (int16_t)(acc[x] + src[x] * weight);
+                }
+            }
+
+            // Apply ReLU activation (clip values to 0-255 range) over the whole strip, branch-free
+            // max_sum includes the rounding offset, so the whole computation stays in 16-bit lanes
+            for (int x = 0; x < STRIP_SAMPLES; x++) {
+                int16_t value = (int16_t)(acc[x] + rounding) >> bits;
+                value = value < 0 ? 0 : value;
+                value = value > 255 ? 255 : value;
+                clipped[x] = (unsigned char)value;
+            }
+        } else if (plan->accumulator == ACCUM_I32) {
+            int32_t acc[STRIP_SAMPLES] = { 0 };
+            for (int a = 0; a < k; a++) {
+                for (int b = 0; b < k; b++) {
+                    int32_t weight = plan->fixed_weights[a * k + b];
+                    if (weight == 0) continue;
+                    const unsigned char *restrict src = first_row + (size_t)a * pitch + b * 3 + x0;
+                    for (int x = 0; x < STRIP_SAMPLES; x++) acc[x] += src[x] * weight;
+                }
+            }
+
+            for (int x = 0; x < STRIP_SAMPLES; x++) {
+                int32_t value = (acc[x] + rounding) >> bits;
+                clipped[x] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+            }
+        } else if (plan->accumulator == ACCUM_FLOAT) {
+            float acc[STRIP_SAMPLES] = { 0.0f };
+            for (int a = 0; a < k; a++) {
+                for (int b = 0; b < k; b++) {
+                    float weight = plan->float_weights[a * k + b];
+                    if (weight == 0.0f) continue;
+                    const unsigned char *restrict src = first_row + (size_t)a * pitch + b * 3 + x0;
+                    for (int x = 0; x < STRIP_SAMPLES; x++) acc[x] += src[x] * weight;
+                }
+            }
+
+            // Same rounding as clip_pixel(): adding 0.5 in double is exact for float sums
+            for (int x = 0; x < STRIP_SAMPLES; x++) {
+                double value = acc[x] + 0.5;
+                value = value < 0.0 ? 0.0 : value;
+                value = value > 255.0 ? 255.0 : value;
+                clipped[x] = (unsigned char)value;
+            }
+        } else {
+            double acc[STRIP_SAMPLES] = { 0.0 };
+            for (int a = 0; a < k; a++) {
+                for (int b = 0; b < k; b++) {
+                    double weight = plan->weights[a * k + b];
+                    if (weight == 0.0) continue;
+                    const unsigned char *restrict src = first_row + (size_t)a * pitch + b * 3 + x0;
+                    for (int x = 0; x < STRIP_SAMPLES; x++) acc[x] += src[x] * weight;
+                }
+            }
+
+            for (int x = 0; x < count; x++) clipped[x] = clip_pixel(acc[x]);
+        }
+
+        memcpy(out_row + x0, clipped, count);
+    }
+}
+
+// Function to filter rows [start_row, end_row) with the given filter-bank kernels in column chunks
+// Each chunk of the input rows is loaded once and all kernels are applied to it while it is in L1
+void filter_rows_chunked(const int *kernels, int count, int start_row, int end_row) {
+    // The shared neighbourhood covers the largest kernel; smaller kernels use its centre
+    int size = 1;
+    for (int k = 0; k < count; k++) {
+        if (bank_ksizes[kernels[k]] > size) size = bank_ksizes[kernels[k]];
+    }
+    int row_size = width * 3;
+    int chunk = chunk_samples(size);
+    int pitch = chunk + (size / 2) * 2 * 3;
+    unsigned char **scratch = reserve_thread_scratch(omp_get_max_threads(), chunk_scratch_size(size));
+
+    #pragma omp parallel
+    {
+        // Per-thread padded input chunk
+        unsigned char *padded = scratch[omp_get_thread_num()];
+
+        // Dynamic schedule allows for better load balancing
+        #pragma omp for schedule(dynamic, 16)
+        for (int i = start_row; i < end_row; i++) {
+            for (int x0 = 0; x0 < row_size; x0 += chunk) {
+                int samples = row_size - x0 < chunk ? row_size - x0 : chunk;
+                load_padded_rows(i, size, x0, samples, padded, pitch);
+
+                // Apply every kernel to the same chunk, each with its own accumulator plan
+                for (int k = 0; k < count; k++) {
+                    int n = kernels[k];
+                    filter_row(&bank_plans[n], bank_ksizes[n], padded, size, pitch, samples,
+                               output_row(bank_outputs[n], i) + x0);
+                }
+            }
             
-            // Apply the 3x3 convolution kernel
-            for (int ki = -1; ki <= 1; ki++) {
-                for (int kj = -1; kj <= 1; kj++) {
-                    int img_row = row + ki;
-                    int col = j + kj;
-                    
-                    // Handle boundary conditions with edge clamping
-                    if (img_row >= 0 && img_row < height && col >= 0 && col < width) {
-                        unsigned char pixel_value = image[img_row * stride + col * 3 + color];
-                        sum += pixel_value * kernel[ki + 1][kj + 1];
+            // Optional: periodically report progress
+            if (num_bank_kernels == 1) {
+                #pragma omp critical
+                {
+                    if (i % 50 == 0 || i == end_row - 1) {
+                        printf("   [Thread %d] - Processed row %d\n", omp_get_thread_num(), i);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Function to apply the active kernel with the direct algorithm to rows [start_row, end_row)
+void apply_direct(int start_row, int end_row) {
+    filter_rows_chunked(&active_kernel, 1, start_row, end_row);
+}
+
+// Function to apply a separable kernel as a row pass followed by a column pass
+// With a plan (see plan_separable) the row pass runs in int32 and the column pass in float,
+// otherwise both run in double
+void apply_separable(int start_row, int end_row) {
+    int radius = ksize / 2;
+    int rows = end_row - start_row + 2 * radius;
+    int row_size = width * 3;
+
+    // Intermediate row-filtered values, including radius halo rows above and below
+    // (plus one strip, as the last column-pass strip may read past the final row)
+    size_t sample_size = separable_plan.use_fixed ? sizeof(int32_t) : sizeof(double);
+    void *partial = reserve_separable_partial(((size_t)rows * row_size + STRIP_SAMPLES) * sample_size);
+
+    if (separable_plan.use_fixed) {
+        const int *row_fixed = separable_plan.row_fixed;
+        const float *col_scaled = separable_plan.col_scaled;
+        int32_t *partial_fixed = (int32_t *)partial;
+        memset(partial_fixed + (size_t)rows * row_size, 0, STRIP_SAMPLES * sizeof(int32_t));
+
+        // Horizontal pass: each tap is a vectorized multiply-add over a clamped copy of the row
+        unsigned char **scratch = reserve_thread_scratch(omp_get_max_threads(), row_size + 2 * radius * 3);
+        #pragma omp parallel
+        {
+            unsigned char *padded = scratch[omp_get_thread_num()];
+
+            #pragma omp for schedule(dynamic, 16)
+            for (int i = 0; i < rows; i++) {
+                load_padded_row(input_row(start_row - radius + i), -radius * 3, row_size + 2 * radius * 3, padded);
+                int32_t *restrict out_row = partial_fixed + (size_t)i * row_size;
+                for (int x = 0; x < row_size; x++) out_row[x] = 0;
+                for (int kj = 0; kj < ksize; kj++) {
+                    int32_t weight = row_fixed[kj];
+                    if (weight == 0) continue;
+                    const unsigned char *restrict src = padded + kj * 3;
+                    for (int x = 0; x < row_size; x++) out_row[x] += src[x] * weight;
+                }
+            }
+        }
+
+        // Vertical pass in strips, as in filter_row
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int i = start_row; i < end_row; i++) {
+            const int32_t *in_rows = partial_fixed + (size_t)(i - start_row) * row_size;
+            unsigned char *out_row = output_row(output_image, i);
+            for (int x0 = 0; x0 < row_size; x0 += STRIP_SAMPLES) {
+                int count = row_size - x0 < STRIP_SAMPLES ? row_size - x0 : STRIP_SAMPLES;
+                float acc[STRIP_SAMPLES] = { 0.0f };
+                unsigned char clipped[STRIP_SAMPLES];
+                for (int ki = 0; ki < ksize; ki++) {
+                    float weight = col_scaled[ki];
+                    if (weight == 0.0f) continue;
+                    const int32_t *restrict src = in_rows + (size_t)ki * row_size + x0;
+                    for (int x = 0; x < STRIP_SAMPLES; x++) acc[x] += (float)src[x] * weight;
+                }
+
+                // Same rounding as clip_pixel(), as in filter_row
+                for (int x = 0; x < STRIP_SAMPLES; x++) {
+                    double value = acc[x] + 0.5;
+                    value = value < 0.0 ? 0.0 : value;
+                    value = value > 255.0 ? 255.0 : value;
+                    clipped[x] = (unsigned char)value;
+                }
+                memcpy(out_row + x0, clipped, count);
+            }
+        }
+        return;
+    }
+
+    double *partial_double = (double *)partial;
+
+    // Horizontal pass
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < rows; i++) {
+        const unsigned char *img_row = input_row(start_row - radius + i);
+        double *out_row = partial_double + (size_t)i * row_size;
+        for (int j = 0; j < width; j++) {
+            for (int color = 0; color < 3; color++) {
+                double sum = 0.0;
+                for (int kj = 0; kj < ksize; kj++) {
+                    sum += img_row[clamp_col(j + kj - radius) * 3 + color] * row_weights[kj];
+                }
+                out_row[j * 3 + color] = sum;
+            }
+        }
+    }
+
+    // Vertical pass (clamping was already applied when the halo rows were filtered)
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = start_row; i < end_row; i++) {
+        const double *in_rows = partial_double + (size_t)(i - start_row) * row_size;
+        unsigned char *out_row = output_row(output_image, i);
+        for (int x = 0; x < row_size; x++) {
+            double sum = 0.0;
+            for (int ki = 0; ki < ksize; ki++) {
+                sum += in_rows[(size_t)ki * row_size + x] * col_weights[ki];
+            }
+            out_row[x] = clip_pixel(sum);
+        }
+    }
+}
+
+// Function to apply radix-2 butterflies with twiddle factor (wr, wi) to two rows of n values
+// The rows must not overlap: with restrict the strip loops vectorize at -O2 without alias checks
+void fft_radix2_rows(double *restrict re0, double *restrict im0, double *restrict re1, double *restrict im1,
+                     double wr, double wi, int n) {
+    for (int x0 = 0; x0 < n; x0 += FFT_STRIP) {
+        for (int x = x0; x < x0 + FFT_STRIP; x++) {
+            double tr = re1[x] * wr - im1[x] * wi;
+            double ti = re1[x] * wi + im1[x] * wr;
+            re1[x] = re0[x] - tr;
+            im1[x] = im0[x] - ti;
+            re0[x] += tr;
+            im0[x] += ti;
+        }
+    }
+}
+
+// Function to apply two radix-2 butterfly stages at once to four rows of n values
+// Rows 0-1 and 2-3 are combined with twiddle factor (wr[0], wi[0]), then rows 0-2 with
+// (wr[1], wi[1]) and rows 1-3 with (wr[2], wi[2]); intermediate values stay in registers
+void fft_radix4_rows(double *restrict re0, double *restrict im0, double *restrict re1, double *restrict im1,
+                     double *restrict re2, double *restrict im2, double *restrict re3, double *restrict im3,
+                     const double *wr, const double *wi, int n) {
+    double wr0 = wr[0], wi0 = wi[0], wr1 = wr[1], wi1 = wi[1], wr2 = wr[2], wi2 = wi[2];
+    for (int x0 = 0; x0 < n; x0 += FFT_STRIP) {
+        for (int x = x0; x < x0 + FFT_STRIP; x++) {
+            // First stage
+            double tr = re1[x] * wr0 - im1[x] * wi0, ti = re1[x] * wi0 + im1[x] * wr0;
+            double a_re = re0[x] + tr, a_im = im0[x] + ti;
+            double b_re = re0[x] - tr, b_im = im0[x] - ti;
+            tr = re3[x] * wr0 - im3[x] * wi0;
+            ti = re3[x] * wi0 + im3[x] * wr0;
+            double c_re = re2[x] + tr, c_im = im2[x] + ti;
+            double d_re = re2[x] - tr, d_im = im2[x] - ti;
+
+            // Second stage
+            tr = c_re * wr1 - c_im * wi1;
+            ti = c_re * wi1 + c_im * wr1;
+            re0[x] = a_re + tr;
+            im0[x] = a_im + ti;
+            re2[x] = a_re - tr;
+            im2[x] = a_im - ti;
+            tr = d_re * wr2 - d_im * wi2;
+            ti = d_re * wi2 + d_im * wr2;
+            re1[x] = b_re + tr;
+            im1[x] = b_im + ti;
+            re3[x] = b_re - tr;
+            im3[x] = b_im - ti;
+        }
+    }
+}
+
+// Function to compute in-place FFTs of all n columns of an n x n block
+// The block is stored as separate real and imaginary parts. Every butterfly combines whole rows, so
+// the inner loops run over contiguous columns and vectorize, and stages are fused in pairs to halve
+// the passes over the block. cos_table[k] and sin_table[k] hold the real and imaginary parts of
+// exp(-2*pi*i*k/FFT_MAX_SIZE) for k < FFT_MAX_SIZE/2, so one table serves every size up to
+// FFT_MAX_SIZE; the inverse is left unscaled.
+void fft_columns(double *re, double *im, int n, const double *cos_table, const double *sin_table, int inverse) {
+    double sign = inverse ? -1.0 : 1.0;
+
+    // Bit-reversal permutation of the rows
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j |= bit;
+        if (i < j) {
+            double *restrict re_i = re + (size_t)i * n, *restrict re_j = re + (size_t)j * n;
+            double *restrict im_i = im + (size_t)i * n, *restrict im_j = im + (size_t)j * n;
+            for (int x = 0; x < n; x++) {
+                double tmp = re_i[x];
+                re_i[x] = re_j[x];
+                re_j[x] = tmp;
+                tmp = im_i[x];
+                im_i[x] = im_j[x];
+                im_j[x] = tmp;
+            }
+        }
+    }
+
+    // A single radix-2 stage first when log2(n) is odd, then fused pairs of stages. A pair turns
+    // transforms of length q into length 4q: the first stage uses exp(-2*pi*i*k/2q), the second
+    // exp(-2*pi*i*k/4q) and exp(-2*pi*i*(k+q)/4q)
+    int q = 1;
+    if ((n & 0x55555555) == 0) {
+        for (int i = 0; i < n; i += 2) {
+            fft_radix2_rows(re + (size_t)i * n, im + (size_t)i * n, re + (size_t)(i + 1) * n, im + (size_t)(i + 1) * n,
+                            1.0, 0.0, n);
+        }
+        q = 2;
+    }
+    for (; q < n; q *= 4) {
+        int step = FFT_MAX_SIZE / (4 * q);
+        for (int i = 0; i < n; i += 4 * q) {
+            for (int k = 0; k < q; k++) {
+                double wr[3] = { cos_table[2 * k * step], cos_table[k * step], cos_table[(k + q) * step] };
+                double wi[3] = { sign * sin_table[2 * k * step], sign * sin_table[k * step], sign * sin_table[(k + q) * step] };
+                size_t r0 = (size_t)(i + k) * n, r1 = r0 + (size_t)q * n, r2 = r1 + (size_t)q * n, r3 = r2 + (size_t)q * n;
+                fft_radix4_rows(re + r0, im + r0, re + r1, im + r1, re + r2, im + r2, re + r3, im + r3, wr, wi, n);
+            }
+        }
+    }
+}
+
+// Function to transpose an n x n block in place
+void transpose_block(double *block, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            double tmp = block[(size_t)i * n + j];
+            block[(size_t)i * n + j] = block[(size_t)j * n + i];
+            block[(size_t)j * n + i] = tmp;
+        }
+    }
+}
+
+// Function to compute the 2D FFT of an n x n block, leaving the result transposed
+// Transposed spectra multiply just like normal ones, and the inverse of a transposed spectrum comes
+// out in the original orientation, so the transposes back are never needed
+void fft_2d(double *re, double *im, int n, int inverse) {
+    fft_columns(re, im, n, fft_cos, fft_sin, inverse);
+    transpose_block(re, n);
+    transpose_block(im, n);
+    fft_columns(re, im, n, fft_cos, fft_sin, inverse);
+}
+
+// Function to choose the FFT size for a kernel: the power of two up to FFT_MAX_SIZE with the lowest
+// transform cost (n^2 log n) per usable output ((n - K + 1)^2)
+int fft_size(int k) {
+    int best = 0;
+    double best_cost = 0.0;
+    for (int n = 8, log_n = 3; n <= FFT_MAX_SIZE; n *= 2, log_n++) {
+        if (n - k + 1 < 1) continue;
+        double cost = (double)n * n * log_n / ((double)(n - k + 1) * (n - k + 1));
+        if (best == 0 || cost < best_cost) {
+            best = n;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// Function to return the scratch size of an n x n FFT block (real and imaginary parts)
+size_t fft_block_size(int n) {
+    return 2 * (size_t)n * n * sizeof(double);
+}
+
+// Function to compute the twiddle factors and the spectrum of the active kernel (once per run)
+double *prepare_fft(void) {
+    if (fft_spectra[active_kernel]) return fft_spectra[active_kernel];
+
+    for (int k = 0; k < FFT_MAX_SIZE / 2; k++) {
+        fft_cos[k] = cos(2.0 * M_PI * k / FFT_MAX_SIZE);
+        fft_sin[k] = -sin(2.0 * M_PI * k / FFT_MAX_SIZE);
+    }
+
+    int n = fft_size(ksize);
+    double *spectrum = (double *)calloc(2 * (size_t)n * n, sizeof(double));
+    if (!spectrum) {
+        printf("Error: Memory allocation failed for the FFT kernel spectrum\n");
+        exit(1);
+    }
+    double *spectrum_re = spectrum, *spectrum_im = spectrum + (size_t)n * n;
+
+    // Kernel spectrum, conjugated so that the product computes a correlation like the direct loop,
+    // and scaled by 1 / n^2 for the unscaled inverse
+    for (int a = 0; a < ksize; a++) {
+        for (int b = 0; b < ksize; b++) spectrum_re[a * n + b] = kernel[a * ksize + b];
+    }
+    fft_2d(spectrum_re, spectrum_im, n, 0);
+    for (int k = 0; k < n * n; k++) {
+        spectrum_re[k] /= (double)n * n;
+        spectrum_im[k] /= -(double)n * n;
+    }
+
+    fft_spectra[active_kernel] = spectrum;
+    return spectrum;
+}
+
+// Function to apply the kernel with tiled FFT convolution (overlap-save)
+// Each n x n input tile yields (n - K + 1)^2 outputs that are free of wrap-around, so tiles are
+// independent. Two real channels share one complex transform, so a pair of neighbouring tiles
+// (six colour channels) takes three transforms.
+void apply_fft(int start_row, int end_row) {
+    int radius = ksize / 2;
+
+    int n = fft_size(ksize);
+    int tile = n - ksize + 1;
+
+    const double *spectrum_re = prepare_fft();
+    const double *spectrum_im = spectrum_re + (size_t)n * n;
+    unsigned char **scratch = reserve_thread_scratch(omp_get_max_threads(), fft_block_size(n));
+
+    int tile_rows = (end_row - start_row + tile - 1) / tile;
+    int tile_cols = (width + tile - 1) / tile;
+    int tile_pairs = (tile_cols + 1) / 2;
+
+    #pragma omp parallel
+    {
+        double *re = (double *)scratch[omp_get_thread_num()];
+        double *im = re + (size_t)n * n;
+
+        #pragma omp for schedule(dynamic, 1) collapse(2)
+        for (int ti = 0; ti < tile_rows; ti++) {
+            for (int pair = 0; pair < tile_pairs; pair++) {
+                int i0 = start_row + ti * tile;
+                const unsigned char *img_rows[128];
+                for (int a = 0; a < n; a++) img_rows[a] = input_row(i0 - radius + a);
+
+                // Channel c is colour c % 3 of tile 2 * pair + c / 3; channel 2p is the real and
+                // channel 2p + 1 the imaginary part of transform p
+                for (int p = 0; p < 3; p++) {
+                    for (int part = 0; part < 2; part++) {
+                        int channel = 2 * p + part, tj = 2 * pair + channel / 3, color = channel % 3;
+                        double *values = part == 0 ? re : im;
+                        if (tj >= tile_cols) {
+                            memset(values, 0, (size_t)n * n * sizeof(double));
+                            continue;
+                        }
+                        int cols[128];
+                        for (int b = 0; b < n; b++) cols[b] = clamp_col(tj * tile - radius + b) * 3 + color;
+                        for (int a = 0; a < n; a++) {
+                            for (int b = 0; b < n; b++) values[a * n + b] = img_rows[a][cols[b]];
+                        }
+                    }
+
+                    fft_2d(re, im, n, 0);
+                    for (int k = 0; k < n * n; k++) {
+                        double r = re[k] * spectrum_re[k] - im[k] * spectrum_im[k];
+                        im[k] = re[k] * spectrum_im[k] + im[k] * spectrum_re[k];
+                        re[k] = r;
                     }
-                    else {
-                        // For out-of-bounds pixels, use the value of the closest valid pixel
-                        int clamped_row = img_row < 0 ? 0 : (img_row >= height ? height - 1 : img_row);
-                        int clamped_col = col < 0 ? 0 : (col >= width ? width - 1 : col);
-                        
-                        unsigned char pixel_value = image[clamped_row * stride + clamped_col * 3 + color];
-                        sum += pixel_value * kernel[ki + 1][kj + 1];
+                    fft_2d(re, im, n, 1);
+
+                    for (int part = 0; part < 2; part++) {
+                        int channel = 2 * p + part, tj = 2 * pair + channel / 3, color = channel % 3;
+                        const double *values = part == 0 ? re : im;
+                        if (tj >= tile_cols) continue;
+                        int j0 = tj * tile;
+                        for (int y = 0; y < tile && i0 + y < end_row; y++) {
+                            unsigned char *out_row = output_row(output_image, i0 + y);
+                            for (int x = 0; x < tile && j0 + x < width; x++) {
+                                out_row[(j0 + x) * 3 + color] = clip_pixel(values[y * n + x]);
+                            }
+                        }
                     }
                 }
             }
-            
-            // Store the convolution result in the appropriate array
-            current_values[j] = sum;
         }
     }
-    
-    // Apply ReLU activation and store results in output image
-    for (int j = 0; j < width; j++) {
-        // Get values from each channel array
-        int red_val = red_values[j];
-        int green_val = green_values[j];
-        int blue_val = blue_values[j];
-        
-        // Apply ReLU activation (clip values to 0-255 range)
-        red_val = red_val < 0 ? 0 : (red_val > 255 ? 255 : red_val);
-        green_val = green_val < 0 ? 0 : (green_val > 255 ? 255 : green_val);
-        blue_val = blue_val < 0 ? 0 : (blue_val > 255 ? 255 : blue_val);
-        
-        // Store the results in the output image
-        output_image[row * stride + j * 3] = (unsigned char)red_val;       // Red
-        output_image[row * stride + j * 3 + 1] = (unsigned char)green_val; // Green
-        output_image[row * stride + j * 3 + 2] = (unsigned char)blue_val;  // Blue
+}
+
+// Function to check whether an algorithm can be used with the active kernel
+int algorithm_supported(Algorithm algorithm) {
+    switch (algorithm) {
+        case ALGO_DIRECT: return 1;
+        case ALGO_SEPARABLE: return kernel_is_separable;
+        case ALGO_FFT: return ksize >= 5 && fft_size(ksize) > 0;
+        default: return 0;
+    }
+}
+
+// Function to filter rows [start_row, end_row) with the given algorithm
+void run_algorithm(Algorithm algorithm, int start_row, int end_row) {
+    switch (algorithm) {
+        case ALGO_SEPARABLE: apply_separable(start_row, end_row); break;
+        case ALGO_FFT: apply_fft(start_row, end_row); break;
+        default: apply_direct(start_row, end_row); break;
     }
-    
-    // Free the allocated memory
-    free(red_values);
-    free(green_values);
-    free(blue_values);
+}
+
+// Function to find a saved algorithm choice for this kernel, image size and thread count
+// Work sizes are grouped by the power of two of the pixel count filtered per call
+Algorithm lookup_profile(int size_class, int num_threads) {
+    FILE *file = fopen(PROFILE_FILENAME, "r");
+    if (!file) return ALGO_AUTO;
+
+    Algorithm choice = ALGO_AUTO;
+    int p_ksize, p_separable, p_size_class, p_threads;
+    char name[32];
+    while (fscanf(file, "%d %d %d %d %31s", &p_ksize, &p_separable, &p_size_class, &p_threads, name) == 5) {
+        if (p_ksize != ksize || p_separable != kernel_is_separable ||
+            p_size_class != size_class || p_threads != num_threads) continue;
+        for (int a = 0; a < NUM_ALGORITHMS; a++) {
+            if (strcmp(name, algorithm_names[a]) == 0) choice = (Algorithm)a;
+        }
+    }
+    fclose(file);
+    return choice;
+}
+
+// Function to time every supported algorithm once and save the fastest to the profile
+// Only output rows [0, rows) are filtered, so calibration also works on the first out-of-core band
+Algorithm calibrate(int size_class, int num_threads, int rows) {
+    printf("\n[Calibration] - Timing algorithms for %dx%d kernel with %d threads\n", ksize, ksize, num_threads);
+    omp_set_num_threads(num_threads);
+
+    // Untimed warm-up so that no algorithm pays the first-touch page faults of the output buffers
+    run_algorithm(ALGO_DIRECT, 0, rows);
+
+    Algorithm best = ALGO_DIRECT;
+    double best_time = 0.0;
+    for (int a = 0; a < NUM_ALGORITHMS; a++) {
+        if (!algorithm_supported((Algorithm)a)) continue;
+
+        // Best of two runs, to filter out cold caches and scheduling noise
+        double elapsed = 0.0;
+        for (int run = 0; run < 2; run++) {
+            double start = omp_get_wtime();
+            run_algorithm((Algorithm)a, 0, rows);
+            double run_time = omp_get_wtime() - start;
+            if (run == 0 || run_time < elapsed) elapsed = run_time;
+        }
+        printf("   [Calibration] - %s: %f seconds\n", algorithm_names[a], elapsed);
+
+        if (a == ALGO_DIRECT || elapsed < best_time) {
+            best = (Algorithm)a;
+            best_time = elapsed;
+        }
+    }
+
+    FILE *file = fopen(PROFILE_FILENAME, "a");
+    if (file) {
+        fprintf(file, "%d %d %d %d %s\n", ksize, kernel_is_separable, size_class, num_threads, algorithm_names[best]);
+        fclose(file);
+    }
+    return best;
+}
+
+// Function to resolve ALGO_AUTO from the calibration profile, calibrating on first use
+// Output rows [0, rows) are filtered per call (the whole image, or one out-of-core band), so the
+// profile is keyed on the size of that work rather than of the image
+Algorithm select_algorithm(Algorithm requested, int num_threads, int rows) {
+    if (requested != ALGO_AUTO) {
+        if (!algorithm_supported(requested)) {
+            printf("Warning: %s does not support the %dx%d kernel, using direct\n", algorithm_names[requested], ksize, ksize);
+            return ALGO_DIRECT;
+        }
+        return requested;
+    }
+
+    int size_class = (int)floor(log2((double)width * rows));
+    Algorithm choice = lookup_profile(size_class, num_threads);
+    if (choice == ALGO_AUTO || !algorithm_supported(choice)) {
+        choice = calibrate(size_class, num_threads, rows);
+    }
+    return choice;
+}
+
+// Function to choose the algorithm of every kernel (explicitly requested or automatic)
+// Kernels the requested algorithm does not support fall back to direct with a warning
+void select_algorithms(Algorithm requested, int num_threads, int rows) {
+    for (int n = 0; n < num_bank_kernels; n++) {
+        select_kernel(n);
+        bank_algorithms[n] = select_algorithm(requested, num_threads, rows);
+        if (num_bank_kernels > 1) {
+            printf("   [Kernel %d] - %dx%d, using %s\n", n, ksize, ksize, algorithm_names[bank_algorithms[n]]);
+        }
+    }
+    select_kernel(0);
+}
+
+// Function to filter rows [start_row, end_row) with every kernel and its selected algorithm
+// Direct kernels share one traversal of the input; separable and FFT kernels run their own
+void filter_rows(int start_row, int end_row) {
+    int direct[MAX_BANK_KERNELS];
+    int num_direct = 0;
+    for (int n = 0; n < num_bank_kernels; n++) {
+        if (bank_algorithms[n] == ALGO_DIRECT) direct[num_direct++] = n;
+    }
+    if (num_direct > 0) filter_rows_chunked(direct, num_direct, start_row, end_row);
+
+    for (int n = 0; n < num_bank_kernels; n++) {
+        if (bank_algorithms[n] == ALGO_DIRECT) continue;
+        select_kernel(n);
+        run_algorithm(bank_algorithms[n], start_row, end_row);
+    }
+    select_kernel(0);
 }
 
 // Function to apply the filter using OpenMP parallelism
 void apply_filter_parallel(int num_threads) {
-    printf("\n[Task the 2: Processing Image with OpenMP] - Using %d threads\n", num_threads);
+    if (num_bank_kernels > 1) {
+        printf("\n[Task the 2: Processing Image with OpenMP] - Using %d threads (filter bank of %d kernels)\n",
+               num_threads, num_bank_kernels);
+    } else {
+        printf("\n[Task the 2: Processing Image with OpenMP] - Using %d threads (%s)\n",
+               num_threads, algorithm_names[bank_algorithms[0]]);
+    }
     
     // Set the number of threads to use
     omp_set_num_threads(num_threads);
     
-    // Dynamic schedule allows for better load balancing
-    #pragma omp parallel for schedule(dynamic, 16)
-    for (int i = 0; i < height; i++) {
-        // Process each row in parallel
-        process_row(i);
-        
-        // Optional: periodically report progress
-        #pragma omp critical
-        {
-            if (i % 50 == 0 || i == height - 1) {
-                printf("   [Thread %d] - Processed row %d\n", omp_get_thread_num(), i);
-            }
-        }
-    }
+    filter_rows(0, height);
     
     printf("[Task 2: Processing Image] - Completed\n");
 }
 
 // Function to save the processed image as a BMP file
-void save_bmp(const char *filename, unsigned char *header) {
+void save_bmp(const char *filename, unsigned char *header, const unsigned char *data) {
     printf("\n[Task 3: Saving Processed BMP Image] - Started\n");
 
     FILE *file = fopen(filename, "wb");
     fwrite(header, 1, BMP_HEADER_SIZE, file);
-    fwrite(output_image, sizeof(unsigned char), height * stride, file);
+    fwrite(data, sizeof(unsigned char), height * stride, file);
     fclose(file);
     
     printf("[Task 3: Saving Processed BMP Image] - Completed\n");
 }
 
+// Function to append a timing result to the log file for performance analysis
+void log_timing(int num_threads, double elapsed) {
+    FILE *log_file = fopen("openmp_timing_results.txt", "a");
+    fprintf(log_file, "%d %f\n", num_threads, elapsed);
+    fclose(log_file);
+}
+
+// Function to free the kernels and their accumulator plans
+void free_kernels(void) {
+    for (int n = 0; n < num_bank_kernels; n++) {
+        if (bank_kernels[n] != default_kernel) free(bank_kernels[n]);
+        free(bank_plans[n].fixed_weights);
+        free(bank_plans[n].float_weights);
+    }
+}
+
+// Function to build the output filename for a kernel (filter-bank outputs are numbered)
+void make_output_filename(char *filename, int num_threads, int kernel_index) {
+    if (num_bank_kernels == 1) {
+        sprintf(filename, "output_openmp_%d_threads.bmp", num_threads);
+    } else {
+        sprintf(filename, "output_openmp_%d_threads_kernel_%d.bmp", num_threads, kernel_index);
+    }
+}
+
+// Function to read the input rows needed for output rows [start_row, end_row), including the halos
+// Returns 0 if the file is shorter than its header claims or cannot be read
+int read_band(FILE *file, int start_row, int end_row, int radius, unsigned char *buffer) {
+    int first = start_row - radius < 0 ? 0 : start_row - radius;
+    int last = end_row + radius > height ? height : end_row + radius;
+
+    if (fseek(file, BMP_HEADER_SIZE + (long)first * stride, SEEK_SET) != 0 ||
+        fread(buffer, stride, last - first, file) != (size_t)(last - first)) {
+        printf("Error: Could not read input rows %d to %d\n", first, last);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to point the filters at a band held in memory
+void use_band(unsigned char *input, int start_row, int end_row, int radius, unsigned char **outputs) {
+    image = input;
+    input_first_row = start_row - radius < 0 ? 0 : start_row - radius;
+    input_end_row = end_row + radius > height ? height : end_row + radius;
+
+    output_image = outputs[0];
+    for (int n = 0; n < num_bank_kernels; n++) bank_outputs[n] = outputs[n];
+    output_first_row = start_row;
+}
+
+// Function to append rows of every output band to its file
+// Returns 0 if any output could not be written (e.g. the disk is full)
+int write_band(FILE **outputs, unsigned char **bands, int rows) {
+    for (int n = 0; n < num_bank_kernels; n++) {
+        if (fwrite(bands[n], stride, rows, outputs[n]) != (size_t)rows) {
+            printf("Error: Could not write output file for kernel %d\n", n);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to free the out-of-core band buffers and close the output files still open
+// Output files are removed unless the image was written completely
+void release_out_of_core(unsigned char **in_bands, unsigned char *out_bands[][MAX_BANK_KERNELS],
+                         FILE **outputs, int num_threads, int complete) {
+    for (int n = 0; n < num_bank_kernels; n++) {
+        if (outputs[n]) fclose(outputs[n]);
+        if (!complete) {
+            char output_filename[100];
+            make_output_filename(output_filename, num_threads, n);
+            remove(output_filename);
+        }
+    }
+    for (int slot = 0; slot < 2; slot++) {
+        free(in_bands[slot]);
+        for (int n = 0; n < num_bank_kernels; n++) free(out_bands[slot][n]);
+    }
+}
+
+// Function to filter the image in horizontal bands without ever holding it whole
+// Two input bands (with kernel-radius halo rows) and two output bands are kept, so the next band is
+// read and the previous one written while the current one is filtered; their size follows the budget
+// The budget covers these buffers and the filters' scratch memory only, not the memory the process
+// needs anyway (code, libraries, thread stacks), which adds a roughly constant few MB on top
+double process_out_of_core(const char *input_filename, int num_threads, Algorithm algorithm, long memory_budget) {
+    printf("\n[Task 1: Opening BMP Image for Out-of-Core Processing] - Started\n");
+
+    FILE *input = fopen(input_filename, "rb");
+    if (!input) {
+        printf("Error: Could not open file %s\n", input_filename);
+        return -1;
+    }
+    unsigned char *header = read_bmp_header(input);
+
+    // The halo covers the largest kernel
+    int size = 1;
+    for (int n = 0; n < num_bank_kernels; n++) {
+        if (bank_ksizes[n] > size) size = bank_ksizes[n];
+    }
+    int radius = size / 2;
+
+    // Memory that does not depend on the band height: one scratch buffer per thread, large enough
+    // for any algorithm calibration may try on any kernel (padded rows or an FFT block), and the
+    // FFT spectra. Kernels run one after another, so they share the scratch and the separable
+    // intermediate, which are sized for the largest user.
+    long scratch = chunk_scratch_size(size);
+    long spectra = 0, partial_sample = 0;
+    for (int n = 0; n < num_bank_kernels; n++) {
+        select_kernel(n);
+        if (kernel_is_separable) {
+            if (width * 3 + 2 * radius * 3 > scratch) scratch = width * 3 + 2 * radius * 3;
+            long sample = separable_plan.use_fixed ? sizeof(int32_t) : sizeof(double);
+            if (sample > partial_sample) partial_sample = sample;
+        }
+        if (algorithm_supported(ALGO_FFT)) {
+            long fft_block = (long)fft_block_size(fft_size(ksize));
+            if (fft_block > scratch) scratch = fft_block;
+            spectra += fft_block;
+        }
+    }
+    select_kernel(0);
+    long fixed = (long)num_threads * scratch + spectra + STRIP_SAMPLES * partial_sample;
+
+    // Memory per band row: double-buffered input and outputs, plus the separable intermediate
+    long per_row = 2L * stride * (1 + num_bank_kernels) + (long)width * 3 * partial_sample;
+    long halo = 2L * (2 * radius) * stride + (long)(2 * radius) * width * 3 * partial_sample;
+
+    long band_rows = (memory_budget - fixed - halo) / per_row;
+    if (band_rows < 1) {
+        printf("Error: Memory budget too small, at least %ld KB is needed for this image and kernel\n",
+               (fixed + halo + per_row + 1023) / 1024);
+        free(header);
+        fclose(input);
+        return -1;
+    }
+    if (band_rows > height) band_rows = height;
+    int num_bands = (height + band_rows - 1) / band_rows;
+    printf("   [Out-of-Core] - %d bands of %ld rows within a %ld KB buffer budget\n", num_bands, band_rows, memory_budget / 1024);
+
+    // Allocate the band buffers and open one output file per kernel
+    unsigned char *in_bands[2] = { NULL, NULL };
+    unsigned char *out_bands[2][MAX_BANK_KERNELS] = { { NULL } };
+    FILE *outputs[MAX_BANK_KERNELS] = { NULL };
+    int buffers_ok = 1;
+    for (int slot = 0; slot < 2; slot++) {
+        in_bands[slot] = (unsigned char *)malloc((band_rows + 2 * radius) * stride);
+        if (!in_bands[slot]) buffers_ok = 0;
+        for (int n = 0; n < num_bank_kernels; n++) {
+            out_bands[slot][n] = (unsigned char *)malloc(band_rows * stride);
+            if (!out_bands[slot][n]) buffers_ok = 0;
+        }
+    }
+    if (!buffers_ok) {
+        printf("Error: Could not allocate memory for the band buffers\n");
+        release_out_of_core(in_bands, out_bands, outputs, num_threads, 0);
+        free(header);
+        fclose(input);
+        return -1;
+    }
+    for (int n = 0; n < num_bank_kernels; n++) {
+        char output_filename[100];
+        make_output_filename(output_filename, num_threads, n);
+        outputs[n] = fopen(output_filename, "wb");
+        if (!outputs[n] || fwrite(header, 1, BMP_HEADER_SIZE, outputs[n]) != BMP_HEADER_SIZE) {
+            printf("Error: Could not write output file %s\n", output_filename);
+            release_out_of_core(in_bands, out_bands, outputs, num_threads, 0);
+            free(header);
+            fclose(input);
+            return -1;
+        }
+    }
+
+    // Reserve all scratch memory now, so the bands (filtered on whichever thread runs the
+    // compute section) reuse it instead of allocating and freeing their own
+    reserve_thread_scratch(num_threads, scratch);
+    if (partial_sample > 0) {
+        reserve_separable_partial(((band_rows + 2 * radius) * width * 3 + STRIP_SAMPLES) * partial_sample);
+    }
+    for (int n = 0; n < num_bank_kernels; n++) {
+        select_kernel(n);
+        if (algorithm_supported(ALGO_FFT)) prepare_fft();
+    }
+    select_kernel(0);
+    printf("[Task 1: Opening BMP Image for Out-of-Core Processing] - Completed\n");
+
+    // Load the first band; automatic algorithm selection calibrates on it if needed
+    int first_end = band_rows < height ? (int)band_rows : height;
+    if (!read_band(input, 0, first_end, radius, in_bands[0])) {
+        release_out_of_core(in_bands, out_bands, outputs, num_threads, 0);
+        free(header);
+        fclose(input);
+        return -1;
+    }
+    use_band(in_bands[0], 0, first_end, radius, out_bands[0]);
+    select_algorithms(algorithm, num_threads, first_end);
+
+    printf("\n[Task 2: Streaming Bands with OpenMP] - Using %d threads (%s)\n", num_threads,
+           num_bank_kernels > 1 ? "filter bank" : algorithm_names[bank_algorithms[0]]);
+
+    double start_time = omp_get_wtime();
+
+    // Reader, writer and the (nested) parallel filter run side by side for each band
+    // A failed read or write stops the stream after the band being filtered
+    int read_ok = 1, write_ok = 1;
+    omp_set_max_active_levels(2);
+    for (int b = 0; read_ok && write_ok && b < num_bands; b++) {
+        int start_row = b * band_rows;
+        int end_row = start_row + band_rows < height ? start_row + band_rows : height;
+
+        #pragma omp parallel sections num_threads(3)
+        {
+            // Read-ahead of the next band
+            #pragma omp section
+            {
+                if (b + 1 < num_bands) {
+                    int next_end = end_row + band_rows < height ? end_row + band_rows : height;
+                    read_ok = read_band(input, end_row, next_end, radius, in_bands[(b + 1) % 2]);
+                }
+            }
+
+            // Write-behind of the previous band
+            #pragma omp section
+            {
+                if (b > 0) write_ok = write_band(outputs, out_bands[(b - 1) % 2], band_rows);
+            }
+
+            // Filter the current band
+            #pragma omp section
+            {
+                use_band(in_bands[b % 2], start_row, end_row, radius, out_bands[b % 2]);
+                omp_set_num_threads(num_threads);
+                filter_rows(start_row, end_row);
+                printf("   [Band %d/%d] - Processed rows %d to %d\n", b + 1, num_bands, start_row, end_row);
+            }
+        }
+    }
+
+    // Write the last band and close the outputs (closing flushes them, so it can fail too)
+    if (read_ok && write_ok) {
+        int last_start = (num_bands - 1) * band_rows;
+        write_ok = write_band(outputs, out_bands[(num_bands - 1) % 2], height - last_start);
+        for (int n = 0; write_ok && n < num_bank_kernels; n++) {
+            if (fclose(outputs[n]) != 0) {
+                printf("Error: Could not write output file for kernel %d\n", n);
+                write_ok = 0;
+            }
+            outputs[n] = NULL;
+        }
+    }
+
+    double end_time = omp_get_wtime();
+
+    // Incomplete outputs are removed
+    release_out_of_core(in_bands, out_bands, outputs, num_threads, read_ok && write_ok);
+    image = output_image = NULL;
+    free(header);
+    fclose(input);
+
+    if (!read_ok || !write_ok) return -1;
+    printf("[Task 2: Streaming Bands] - Completed\n");
+    return end_time - start_time;
+}
+
 // Main function - entry point of the program
 int main(int argc, char *argv[]) {
     double start_time, end_time;
     unsigned char *header = NULL;
     int num_threads;
+    const char *kernel_filenames[MAX_BANK_KERNELS];
+    int num_kernel_files = 0;
+    Algorithm algorithm = ALGO_AUTO;
+    long memory_budget = 0;
+    
+    // Separate the options from the positional arguments
+    const char *positional[2];
+    int num_positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            if (num_kernel_files == MAX_BANK_KERNELS) {
+                printf("Error: At most %d kernels can be applied together\n", MAX_BANK_KERNELS);
+                return 1;
+            }
+            kernel_filenames[num_kernel_files++] = argv[++i];
+        } else if (strcmp(argv[i], "--algorithm") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            algorithm = NUM_ALGORITHMS;
+            if (strcmp(name, "auto") == 0) algorithm = ALGO_AUTO;
+            for (int a = 0; a < NUM_ALGORITHMS; a++) {
+                if (strcmp(name, algorithm_names[a]) == 0) algorithm = (Algorithm)a;
+            }
+            if (algorithm == NUM_ALGORITHMS) {
+                printf("Error: Unknown algorithm %s (auto, direct, separable, fft)\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            memory_budget = atol(argv[++i]) * 1024 * 1024;
+            if (memory_budget <= 0) {
+                printf("Error: Memory budget must be a positive number of MB\n");
+                return 1;
+            }
+        } else if (num_positional < 2) {
+            positional[num_positional++] = argv[i];
+        } else {
+            num_positional = 0;
+            break;
+        }
+    }
     
     // Check if command line arguments are provided
-    if (argc < 2 || argc > 3) {
-        printf("Usage: %s <input BMP file> [number of threads]\n", argv[0]);
+    if (num_positional < 1) {
+        printf("Usage: %s <input BMP file> [number of threads] [--kernel FILE]... [--algorithm NAME] [--memory-budget MB]\n", argv[0]);
+        printf("       --memory-budget bounds the image buffers and filter scratch memory, not the process baseline\n");
         return 1;
     }
     
     // Get the input filename from command line arguments
-    const char *input_filename = argv[1];
+    const char *input_filename = positional[0];
     
     // Set the number of threads (use command line or default to max available)
-    if (argc == 3) {
-        num_threads = atoi(argv[2]);
+    if (num_positional == 2) {
+        num_threads = atoi(positional[1]);
     } else {
         num_threads = omp_get_max_threads();
     }
     
+    // Load the kernels (the built-in sharpening kernel is used by default)
+    // Giving more than one kernel switches to filter-bank mode
+    for (int n = 0; n < num_kernel_files; n++) {
+        if (!read_kernel(kernel_filenames[n])) {
+            for (int m = 0; m < n; m++) free(bank_kernels[m]);
+            return 1;
+        }
+        bank_kernels[n] = kernel;
+        bank_ksizes[n] = ksize;
+    }
+    if (num_kernel_files == 0) {
+        bank_kernels[0] = default_kernel;
+        bank_ksizes[0] = 3;
+    }
+    num_bank_kernels = num_kernel_files > 0 ? num_kernel_files : 1;
+    
+    // Prove the accumulator range of each kernel and pick its arithmetic
+    printf("\n[Kernel Analysis] - Started\n");
+    for (int n = 0; n < num_bank_kernels; n++) {
+        bank_plans[n] = analyse_kernel(bank_kernels[n], bank_ksizes[n]);
+        printf("   [Kernel %d] - %dx%d, accumulator range [%ld, %ld], using %s (Q%d)\n",
+               n, bank_ksizes[n], bank_ksizes[n], bank_plans[n].min_sum, bank_plans[n].max_sum,
+               accumulator_names[bank_plans[n].accumulator], bank_plans[n].frac_bits);
+
+        select_kernel(n);
+        if (kernel_is_separable) {
+            bank_separable_plans[n] = plan_separable();
+            if (bank_separable_plans[n].use_fixed) {
+                printf("   [Kernel %d] - Separable: int32 row pass (Q%d), float column pass\n",
+                       n, bank_separable_plans[n].row_bits);
+            } else {
+                printf("   [Kernel %d] - Separable: double passes (no accurate enough int32/float plan)\n", n);
+            }
+        }
+    }
+    select_kernel(0);
+    printf("[Kernel Analysis] - Completed\n");
+    
     // Create a string for the output filename
     char output_filename[100];
-    sprintf(output_filename, "output_openmp_%d_threads.bmp", num_threads);
+    make_output_filename(output_filename, num_threads, 0);
     
     printf("\n[Program Start] OpenMP Image Processing Begins with %d threads\n", num_threads);
     
+    // Out-of-core mode streams the image in bands instead of reading it whole
+    if (memory_budget > 0) {
+        double elapsed = process_out_of_core(input_filename, num_threads, algorithm, memory_budget);
+        if (elapsed >= 0) {
+            printf("\n[Task 4: Execution Time] - %f seconds\n", elapsed);
+            log_timing(num_threads, elapsed);
+            printf("\n[Program End] OpenMP Image Processing Completed\n");
+        }
+        free_kernels();
+        free_scratch();
+        return elapsed >= 0 ? 0 : 1;
+    }
+    
     // Read the BMP image
     header = read_bmp(input_filename);
     if (!header) {
@@ -199,6 +1487,19 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    // The first kernel writes to output_image; every other filter-bank kernel gets its own buffer
+    bank_outputs[0] = output_image;
+    for (int n = 1; n < num_bank_kernels; n++) {
+        bank_outputs[n] = (unsigned char *)malloc(height * stride);
+        if (!bank_outputs[n]) {
+            printf("Error: Could not allocate memory for filter bank output %d\n", n);
+            return 1;
+        }
+    }
+    
+    // Choose the convolution algorithm of each kernel (may run a one-time calibration)
+    select_algorithms(algorithm, num_threads, height);
+    
     // Start the timer
     start_time = omp_get_wtime();
     
@@ -211,20 +1512,27 @@ int main(int argc, char *argv[]) {
     // Print the execution time
     printf("\n[Task 4: Execution Time] - %f seconds\n", end_time - start_time);
     
-    // Save the processed image
-    save_bmp(output_filename, header);
+    // Save the processed image (one file per kernel in filter-bank mode)
+    if (num_bank_kernels == 1) {
+        save_bmp(output_filename, header, output_image);
+    } else {
+        for (int n = 0; n < num_bank_kernels; n++) {
+            make_output_filename(output_filename, num_threads, n);
+            save_bmp(output_filename, header, bank_outputs[n]);
+        }
+    }
     
     // Log the timing results to a file for performance analysis
-    FILE *log_file = fopen("openmp_timing_results.txt", "a");
-    fprintf(log_file, "%d %f\n", num_threads, end_time - start_time);
-    fclose(log_file);
+    log_timing(num_threads, end_time - start_time);
     
     printf("\n[Program End] OpenMP Image Processing Completed\n");
     
     // Free allocated memory
     free(header);
     free(image);
-    free(output_image);
+    for (int n = 0; n < num_bank_kernels; n++) free(bank_outputs[n]);
+    free_kernels();
+    free_scratch();
     
     return 0;
 }
\ No newline at end of file